@@ -5,6 +5,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#if JOB_PROFILE || JOB_MONITOR
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#endif
 
 /* this algo is derived from: https://github.com/cdwfs/cds_job */
 
@@ -28,6 +35,28 @@ pause_thread( void ) {
 #endif
 }
 
+#if JOB_PROFILE
+/* cycle counter for the profiler */
+static inline uint64_t
+get_cycles( void ) {
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+  return __builtin_ia32_rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+/* measure the cycles of a scheduler path, PROF_END adds it to thr.prof,
+ * PROF_ADD adds the cycles only, for a path already counted as a call */
+#define JOB_PROF_START( t )        uint64_t t = get_cycles()
+#define JOB_PROF_END( thr, s, t )  (thr).prof.add_sched( s, get_cycles() - t )
+#define JOB_PROF_ADD( thr, s, t )  \
+  (thr).prof.add_sched( s, get_cycles() - t, 0 )
+#else
+#define JOB_PROF_START( t )
+#define JOB_PROF_END( thr, s, t )
+#define JOB_PROF_ADD( thr, s, t )
+#endif
+
 /* a random state given to each task for stealing jobs from other
  * threads randomly (xoroshiro128* algo) */
 struct XoroRand {
@@ -63,7 +92,8 @@ typedef void (*JobFunction)( JobTaskThread &thr,  Job &job );
 
 /* the work stealing queue */
 /* the owner of the queue pushes at the bottom and consumes there as well
- * the stealers consume from the top
+ * the stealers consume from the top, the owner may also consume from the
+ * top with pop_top(), to run the oldest job first (FIFO)
  *
  *  +--------+ <- entries[ 0 ]
  *  |  top   | <- stealers consume here: job = entries[ top++ ]
@@ -103,12 +133,20 @@ struct WSQIndex {
 };
 
 struct JobAllocBlock;
+#if JOB_SLOT_ALLOC
+/* a released job slot, linked into the free lists of the thread which
+ * allocated it, the next pointer overlays Job::thr */
+struct JobFreeSlot {
+  JobFreeSlot * next;
+};
+#endif
 struct Job {
   JobTaskThread       & thr;         /* the initiator thread */
   JobFunction           function;    /* function called to complete job */
   Job                 * parent;      /* if a child job */
   void                * data;        /* closure data */
-  JobAllocBlock       & alloc_block; /* allocation location for job release */
+  JobAllocBlock       & alloc_block; /* allocation location for job release,
+                                        not used with JOB_SLOT_ALLOC */
   std::atomic<uint32_t> unfinished_jobs; /* if children are not yet finished */
   uint16_t              execute_worker_id; /* which thraed executed job */
   bool                  is_done,    /* set after finished */
@@ -125,9 +163,81 @@ struct Job {
   void kick( void );
   /* queue for execute(), if queue is not full */
   bool try_kick( void );
-  /* subtract one from ref count, if parent not null */
-  void finish( void );
+  /* subtract one from ref count, notify parent and release job memory
+   * through thr when the last one, thr is the thread that executed it */
+  void finish( JobTaskThread &thr );
+  /* release job memory from thr, a waiting job is released by the waiter */
+  void release( JobTaskThread &thr );
+};
+
+#if JOB_PROFILE
+/* the scheduler paths measured by JOB_PROF_END() */
+enum JobProfSched {
+  PROF_POP = 0,    /* job found in own queue by pop_job() */
+  PROF_STEAL,      /* job stolen from another queue, including the search */
+  PROF_PUSH,       /* kick(), multi_push() and multi_push_avail() */
+  PROF_ALLOC,      /* alloc_job() and alloc_jobs() */
+  PROF_FINISH,     /* job.finish() after the function returns */
+  PROF_IDLE,       /* get_valid_job() found nothing, one call per search,
+                      and the pause_thread() which follows it */
+  PROF_SCHED_COUNT
 };
+                      /* number of distinct job functions counted */
+static const uint32_t PROF_FUNC_SLOTS = 256;
+
+/* counters for a job function executed by a worker */
+struct JobProfFunc {
+  JobFunction function; /* key, null when slot is empty */
+  uint64_t    calls,    /* number of times executed */
+              cycles,   /* cycles within function, less nested cycles */
+              incl_cycles, /* cycles within function, with nested cycles */
+              stolen;   /* calls where job was queued by another thread */
+};
+
+/* per worker profile, only written by the owner thread and only read by
+ * JobSysCtx::profile_report() after the workers have stopped */
+struct JobProfile {
+  JobProfFunc func[ PROF_FUNC_SLOTS ]; /* hashed by function pointer */
+  JobProfFunc other;                   /* functions when func[] is full */
+  uint64_t    sched_cycles[ PROF_SCHED_COUNT ],
+              sched_calls[ PROF_SCHED_COUNT ],
+              nested_cycles; /* scheduler and execute() cycles measured
+                                within the running job function */
+
+  JobProfile() { ::memset( (void *) this, 0, sizeof( *this ) ); }
+
+  JobProfFunc & lookup( JobFunction f ) {
+    uint64_t h = (uint64_t) (uintptr_t) f * 0x9e3779b97f4a7c15ULL;
+    uint32_t i = (uint32_t) ( h >> 32 ) & ( PROF_FUNC_SLOTS - 1 );
+    for ( uint32_t k = 0; k < PROF_FUNC_SLOTS; k++ ) {
+      JobProfFunc & p = this->func[ i ];
+      if ( p.function == f )
+        return p;
+      if ( p.function == nullptr ) {
+        p.function = f;
+        return p;
+      }
+      i = ( i + 1 ) & ( PROF_FUNC_SLOTS - 1 );
+    }
+    return this->other;
+  }
+  void add_job( JobFunction f,  uint64_t cycles,  uint64_t incl_cycles,
+                bool is_stolen ) {
+    JobProfFunc & p = this->lookup( f );
+    p.calls       += 1;
+    p.cycles      += cycles;
+    p.incl_cycles += incl_cycles;
+    p.stolen      += ( is_stolen ? 1 : 0 );
+  }
+  /* the cycles are also nested within a job function, if one is running,
+   * execute() subtracts these from the job's cycles */
+  void add_sched( JobProfSched s,  uint64_t cycles,  uint64_t calls = 1 ) {
+    this->sched_cycles[ s ] += cycles;
+    this->sched_calls[ s ]  += calls;
+    this->nested_cycles     += cycles;
+  }
+};
+#endif
 
 /* work stealing queue:  an array of jobs and index of top and bottom, with
  * a counter that tracks how many empty slots are available -- this is
@@ -216,6 +326,25 @@ struct WSQ {
       }
     }
   }
+  /* pop_top() can only be called by the thread which owns this queue, it
+   * consumes the oldest job, where the stealers consume */
+  Job *pop_top( void ) {
+    for (;;) {
+      uint64_t v = this->idx.load( std::memory_order_relaxed );
+      WSQIndex i( v );
+      if ( i.count == 0 ) /* if nothing in the queue */
+        return nullptr;
+      WSQIndex j = { (uint16_t) ( ( i.top + 1 ) & MASK_JOBS ), i.bottom,
+                     (uint16_t) ( i.count - 1 ), i.count };
+      /* fetch idx location, it could be stolen first */
+      if ( std::atomic_compare_exchange_strong( &this->idx, &v, j.u64() ) ) {
+        Job *job = this->entries[ i.top ].exchange( nullptr,
+                                                std::memory_order_relaxed );
+        assert( job != nullptr ); /* owner stored it before this pop */
+        return job;
+      }
+    }
+  }
   /* steal() must be called by threads which do not own this queue */
   uint16_t steal( uint16_t n,  Job **jar ) {
     uint64_t v = this->idx.load( std::memory_order_relaxed );
@@ -268,18 +397,69 @@ struct JobTaskThread {
   XoroRand        rand;      /* rand state for choosing a task to steal from */
   JobSysCtx     & ctx;       /* contains all of the threads */
   JobAllocBlock * cur_block; /* allocate jobs from this block */
+  JobAllocBlock * deref_block; /* block of finished jobs not yet deref()ed */
+  uint32_t        deref_count; /* count of finished jobs in deref_block */
   void          * data;      /* application closure for thread */
   const uint16_t  worker_id; /* the index of task[] in JobSysCtx for this thr */
+  uint16_t        fifo_interval, /* every Nth pop is FIFO, 0 = always LIFO */
+                  pop_count;     /* jobs popped since the last FIFO pop */
+#if JOB_PROFILE
+  JobProfile      prof;      /* job and scheduler cycles of this thread */
+#endif
+#if JOB_SLOT_ALLOC
+  JobFreeSlot   * free_list;  /* slots released by this thread, reused first */
+  JobFreeSlot   * free_batch, /* slots allocated by free_thr, released here */
+                * free_tail;  /* last slot of free_batch */
+  JobTaskThread * free_thr;   /* owner of free_batch */
+  uint32_t        free_count; /* count of slots in free_batch */
+  /* slots released by other threads, pushed by them, taken by owner, this
+   * is on a separate cache line so the pushes don't hit the owner's fields */
+  alignas( 64 ) std::atomic<JobFreeSlot *> remote_free;
+#endif
+#if JOB_MONITOR
+  /* published by execute() for JobMonitor, which only reads them, these
+   * are on a separate cache line from the queue index and the allocator */
+  alignas( 64 ) std::atomic<uint64_t> exec_count; /* jobs started, resumed */
+  std::atomic<JobFunction> exec_function; /* innermost function or null */
+#endif
 
   void * operator new( size_t, void *ptr ) { return ptr; }
   void operator delete( void *ptr ) { std::free( ptr ); }
 
   JobTaskThread( JobSysCtx &c,  uint32_t id,  uint64_t seed,  void *dat )
-    : queue( id ), ctx( c ), cur_block( 0 ), data( dat ), worker_id( id ) {
+    : queue( id ), ctx( c ), cur_block( 0 ), deref_block( 0 ),
+      deref_count( 0 ), data( dat ), worker_id( id ), fifo_interval( 0 ),
+      pop_count( 0 ) {
     this->rand.init( id, seed );
+#if JOB_SLOT_ALLOC
+    this->free_list  = nullptr;
+    this->free_batch = nullptr;
+    this->free_tail  = nullptr;
+    this->free_thr   = nullptr;
+    this->free_count = 0;
+    this->remote_free.store( nullptr, std::memory_order_relaxed );
+#endif
+#if JOB_MONITOR
+    this->exec_count.store( 0, std::memory_order_relaxed );
+    this->exec_function.store( nullptr, std::memory_order_relaxed );
+#endif
   }
   /* allocate space from cur_block for job */
   void * alloc_job( void );
+  /* allocate up to n contiguous job slots from cur_block, n is updated */
+  void * alloc_jobs( uint16_t &n );
+  /* count a finished job in b, deref() when block changes or when idle */
+  void release_job( JobAllocBlock &b );
+  /* deref() the finished jobs counted by release_job() */
+  void flush_release( void );
+#if JOB_SLOT_ALLOC
+  /* pop a released slot, local first, then take all of remote_free */
+  void * alloc_slot( void );
+  /* put j on free_list if allocated here, otherwise batch for j.thr */
+  void release_slot( Job &j );
+  /* push the slots hd .. tl onto remote_free, callable by any thread */
+  void push_remote_free( JobFreeSlot *hd,  JobFreeSlot *tl );
+#endif
   /* kick job and do work until it is done */
   void kick_and_wait_for( Job &j );
   /* kick several jobs */
@@ -295,6 +475,12 @@ struct JobTaskThread {
   /* create a job as child of j, so that the parent is notified when all
    * children have finished */
   Job * create_job_as_child( Job &j,  JobFunction f,  void *d = nullptr );
+  /* create n jobs and kick them, d[ i ] is the closure of job i (or null),
+   * if p is not null, the jobs are children of p */
+  void create_jobs( uint32_t n,  JobFunction f,  void **d = nullptr,
+                    Job *p = nullptr );
+  /* pop a job from this thread's queue, LIFO or FIFO by fifo_interval */
+  Job * pop_job( void );
   /* check this thread's queue with pop, then randomly check other threads
    * queue and steal jobs from them */
   Job * get_valid_job( void );
@@ -324,10 +510,20 @@ struct JobAllocBlock {
     }
     return nullptr;
   }
+  /* return up to n contiguous slots, n is set to the number returned */
+  void * new_jobs( uint16_t &n ) {
+    if ( this->avail_count > 0 ) {
+      if ( n > this->avail_count )
+        n = (uint16_t) this->avail_count;
+      this->avail_count -= n;
+      return &this->mem[ JOB_SIZE * this->avail_count ];
+    }
+    return nullptr;
+  }
   /* if all freed, delete the block */
-  void deref( void ) {
-    uint32_t left = this->ref_count.fetch_sub( 1, std::memory_order_relaxed );
-    if ( left == 1 )
+  void deref( uint32_t n = 1 ) {
+    uint32_t left = this->ref_count.fetch_sub( n, std::memory_order_relaxed );
+    if ( left == n )
       delete this;
   }
 };
@@ -338,8 +534,13 @@ struct JobSysCtx {
   std::atomic<uint32_t> wait_count;        /* how many task[] are in waiting */
   std::atomic<uint32_t> task_count;        /* how many task[] are used */
   std::atomic<bool>     is_sys_active;     /* threads exit when false */
+  uint16_t              fifo_interval;     /* copied to workers initialized */
 
   JobTaskThread * initialize_worker( int64_t seed,  void *data );
+#if JOB_PROFILE
+  /* print the job functions and scheduler cycles, call after workers stop */
+  void profile_report( FILE *fp );
+#endif
 
   /* workers run until is_sys_active is false */
   void activate( void ) {
@@ -348,7 +549,14 @@ struct JobSysCtx {
   void deactivate( void ) {
     this->is_sys_active.store( false, std::memory_order_relaxed );
   }
-  JobSysCtx() : wait_count( 0 ), task_count( 0 ), is_sys_active( false ) {}
+  /* every nth job the owner pops from its queue is the oldest, n = 1 is
+   * FIFO, n = 0 is LIFO, pops that find the queue empty are not counted,
+   * this applies to workers initialized after it is set */
+  void set_fifo_interval( uint16_t n ) {
+    this->fifo_interval = n;
+  }
+  JobSysCtx() : wait_count( 0 ), task_count( 0 ), is_sys_active( false ),
+                fifo_interval( 0 ) {}
 };
 
 /* construct a new thread worker, including a queue for jobs to run */
@@ -358,14 +566,138 @@ JobSysCtx::initialize_worker( int64_t seed,  void *data ) {
   /* align task queues and index on a 64 byte cache line */
   void * m = ::aligned_alloc( 64, sizeof( JobTaskThread ) );
   JobTaskThread * thr = new ( m ) JobTaskThread( *this, count, seed, data );
+  thr->fifo_interval = this->fifo_interval;
   this->task[ count ] = thr;
   this->task_count.store( count+1, std::memory_order_relaxed );
   return thr;
 }
 
+#if JOB_PROFILE || JOB_MONITOR
+/* name of job function f, demangled, or module+offset for addr2line when
+ * not exported (static functions or not linked with -rdynamic) */
+static void
+job_symbol( JobFunction f,  char *buf,  size_t len ) {
+  Dl_info info;
+  bool    is_found = false;
+  if ( f == nullptr ) {
+    ::snprintf( buf, len, "(other)" );
+    return;
+  }
+  if ( ::dladdr( (void *) f, &info ) != 0 ) /* info only set when found */
+    is_found = true;
+  if ( is_found && info.dli_sname != nullptr ) {
+    int    status;
+    char * dm = abi::__cxa_demangle( info.dli_sname, nullptr, nullptr,
+                                     &status );
+    ::snprintf( buf, len, "%s", status == 0 ? dm : info.dli_sname );
+    ::free( dm );
+  }
+  else if ( is_found && info.dli_fname != nullptr ) {
+    const char * p = ::strrchr( info.dli_fname, '/' );
+    ::snprintf( buf, len, "%s+0x%lx", p != nullptr ? &p[ 1 ] : info.dli_fname,
+                (unsigned long) ( (uintptr_t) f -
+                                  (uintptr_t) info.dli_fbase ) );
+  }
+  else {
+    ::snprintf( buf, len, "%p", (void *) f );
+  }
+}
+#endif
+
+#if JOB_PROFILE
+/* sum the profiles of all workers, print the scheduler split per worker and
+ * the job functions by total cycles, a function is marked with '*' when its
+ * cycles per call are less than the scheduler cycles per job */
+void
+JobSysCtx::profile_report( FILE *fp ) {
+  static const char * sched_name[ PROF_SCHED_COUNT ] =
+    { "Pop", "Steal", "Push", "Alloc", "Finish", "Idle" };
+  uint32_t      count = this->task_count.load( std::memory_order_relaxed );
+  JobProfile  * all   = new JobProfile();
+  JobProfFunc * fn[ PROF_FUNC_SLOTS + 1 ];
+  uint64_t      jobs  = 0, job_cycles = 0, sched_cycles = 0, n = 0;
+
+  ::fprintf( fp, "Worker          Jobs   Job %%" );
+  for ( uint32_t s = 0; s < PROF_SCHED_COUNT; s++ )
+    ::fprintf( fp, "  %6s %%", sched_name[ s ] );
+  ::fprintf( fp, "\n" );
+  for ( uint32_t i = 0; i < count; i++ ) {
+    JobProfile & p = this->task[ i ]->prof;
+    uint64_t w_jobs = 0, w_cycles = 0, total;
+    for ( uint32_t k = 0; k <= PROF_FUNC_SLOTS; k++ ) {
+      JobProfFunc & f = ( k < PROF_FUNC_SLOTS ? p.func[ k ] : p.other );
+      if ( f.calls == 0 )
+        continue;
+      JobProfFunc & g = ( k < PROF_FUNC_SLOTS ? all->lookup( f.function ) :
+                          all->other );
+      g.calls       += f.calls;
+      g.cycles      += f.cycles;
+      g.incl_cycles += f.incl_cycles;
+      g.stolen      += f.stolen;
+      w_jobs   += f.calls;
+      w_cycles += f.cycles;
+    }
+    total = w_cycles;
+    for ( uint32_t s = 0; s < PROF_SCHED_COUNT; s++ ) {
+      all->sched_cycles[ s ] += p.sched_cycles[ s ];
+      all->sched_calls[ s ]  += p.sched_calls[ s ];
+      total += p.sched_cycles[ s ];
+    }
+    if ( total == 0 )
+      total = 1;
+    ::fprintf( fp, "%6u  %12lu  %6.2f", i, w_jobs,
+               100.0 * (double) w_cycles / (double) total );
+    for ( uint32_t s = 0; s < PROF_SCHED_COUNT; s++ )
+      ::fprintf( fp, "  %8.2f",
+                 100.0 * (double) p.sched_cycles[ s ] / (double) total );
+    ::fprintf( fp, "\n" );
+    jobs       += w_jobs;
+    job_cycles += w_cycles;
+  }
+  /* the cost of scheduling a job, without idle */
+  for ( uint32_t s = 0; s < PROF_SCHED_COUNT; s++ )
+    if ( s != PROF_IDLE )
+      sched_cycles += all->sched_cycles[ s ];
+  uint64_t sched_per_job = ( jobs == 0 ? 0 : sched_cycles / jobs );
+  ::fprintf( fp, "Scheduler cycles per job: %lu\n\n", sched_per_job );
+
+  for ( uint32_t k = 0; k < PROF_FUNC_SLOTS; k++ )
+    if ( all->func[ k ].calls != 0 )
+      fn[ n++ ] = &all->func[ k ];
+  if ( all->other.calls != 0 )
+    fn[ n++ ] = &all->other;
+  std::sort( fn, &fn[ n ], []( const JobProfFunc *x, const JobProfFunc *y ) {
+    return x->cycles > y->cycles; } );
+  /* Cycles/call is exclusive of nested jobs and scheduler, Incl/call is
+   * inclusive, Job % is of the exclusive cycles of all jobs */
+  ::fprintf( fp, "  %-40s  %12s  %12s  %12s  %11s  %11s  %6s\n", "Function",
+             "Calls", "Local", "Stolen", "Cycles/call", "Incl/call",
+             "Job %" );
+  for ( uint64_t k = 0; k < n; k++ ) {
+    char     name[ 256 ];
+    uint64_t per_call = fn[ k ]->cycles / fn[ k ]->calls;
+    job_symbol( fn[ k ]->function, name, sizeof( name ) );
+    ::fprintf( fp, "%c %-40s  %12lu  %12lu  %12lu  %11lu  %11lu  %6.2f\n",
+               per_call < sched_per_job ? '*' : ' ', name, fn[ k ]->calls,
+               fn[ k ]->calls - fn[ k ]->stolen, fn[ k ]->stolen, per_call,
+               fn[ k ]->incl_cycles / fn[ k ]->calls,
+               100.0 * (double) fn[ k ]->cycles /
+                 (double) ( job_cycles == 0 ? 1 : job_cycles ) );
+  }
+  delete all;
+}
+#endif
+
 void *
 JobTaskThread::alloc_job( void ) {
+  JOB_PROF_START( t );
   void * m;
+#if JOB_SLOT_ALLOC
+  if ( (m = this->alloc_slot()) != nullptr ) {
+    JOB_PROF_END( *this, PROF_ALLOC, t );
+    return m;
+  }
+#endif
   if ( this->cur_block == NULL ||
        (m = this->cur_block->new_job()) == NULL ) {
     if ( this->cur_block != NULL )
@@ -374,9 +706,112 @@ JobTaskThread::alloc_job( void ) {
     this->cur_block = new ( m ) JobAllocBlock();
     m = this->cur_block->new_job();
   }
+  JOB_PROF_END( *this, PROF_ALLOC, t );
   return m;
 }
 
+/* same as alloc_job(), but carves up to n slots at once */
+void *
+JobTaskThread::alloc_jobs( uint16_t &n ) {
+  JOB_PROF_START( t );
+  void * m;
+#if JOB_SLOT_ALLOC
+  if ( (m = this->alloc_slot()) != nullptr ) { /* released slots first */
+    n = 1;
+    JOB_PROF_END( *this, PROF_ALLOC, t );
+    return m;
+  }
+#endif
+  if ( this->cur_block == NULL ||
+       (m = this->cur_block->new_jobs( n )) == NULL ) {
+    if ( this->cur_block != NULL )
+      this->cur_block->deref();
+    m = ::aligned_alloc( 64, sizeof( JobAllocBlock ) );
+    this->cur_block = new ( m ) JobAllocBlock();
+    m = this->cur_block->new_jobs( n );
+  }
+  JOB_PROF_END( *this, PROF_ALLOC, t );
+  return m;
+}
+
+/* jobs usually finish in the order they were allocated, so runs of them
+ * share a block, accumulate these and subtract from ref_count once */
+void
+JobTaskThread::release_job( JobAllocBlock &b ) {
+  if ( &b != this->deref_block ) {
+    this->flush_release();
+    this->deref_block = &b;
+  }
+  this->deref_count += 1;
+}
+
+void
+JobTaskThread::flush_release( void ) {
+  if ( this->deref_count != 0 ) {
+    this->deref_block->deref( this->deref_count );
+    this->deref_count = 0;
+  }
+  this->deref_block = nullptr;
+#if JOB_SLOT_ALLOC
+  if ( this->free_count != 0 ) {
+    this->free_thr->push_remote_free( this->free_batch, this->free_tail );
+    this->free_batch = nullptr;
+    this->free_count = 0;
+  }
+  this->free_thr = nullptr;
+#endif
+}
+
+#if JOB_SLOT_ALLOC
+/* slot reuse, similar to mimalloc:  each thread reuses the slots of the jobs
+ * it allocated, a slot released by the owner goes on free_list without
+ * atomics, a slot released by another thread is batched and pushed onto the
+ * owner's remote_free stack, the owner takes the whole stack when free_list
+ * is empty, so there is no ABA problem with the pops; the blocks are not
+ * deref()ed by the slots, their memory stays with the thread and is reused */
+void *
+JobTaskThread::alloc_slot( void ) {
+  JobFreeSlot * s = this->free_list;
+  if ( s == nullptr ) {
+    if ( this->remote_free.load( std::memory_order_relaxed ) == nullptr )
+      return nullptr;
+    s = this->remote_free.exchange( nullptr, std::memory_order_acquire );
+  }
+  this->free_list = s->next;
+  return s;
+}
+
+void
+JobTaskThread::release_slot( Job &j ) {
+  JobTaskThread & owner = j.thr; /* read before next overlays it */
+  JobFreeSlot   * s     = (JobFreeSlot *) (void *) &j;
+  if ( &owner == this ) {
+    s->next = this->free_list;
+    this->free_list = s;
+    return;
+  }
+  /* batch until owner changes, limit so owner does not run out of slots */
+  if ( &owner != this->free_thr || this->free_count == 64 ) {
+    this->flush_release();
+    this->free_thr  = &owner;
+    this->free_tail = s;
+  }
+  s->next = this->free_batch;
+  this->free_batch = s;
+  this->free_count += 1;
+}
+
+void
+JobTaskThread::push_remote_free( JobFreeSlot *hd,  JobFreeSlot *tl ) {
+  JobFreeSlot * top = this->remote_free.load( std::memory_order_relaxed );
+  do {
+    tl->next = top;
+  } while ( ! this->remote_free.compare_exchange_weak( top, hd,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed ) );
+}
+#endif
+
 /* create a job, does not queue it for running until job.kick() is called  */
 Job *
 JobTaskThread::create_job( JobFunction f,  void *d ) {
@@ -392,13 +827,62 @@ JobTaskThread::create_job_as_child( Job &j,  JobFunction f,  void *d ) {
   return new ( m ) Job( *this, f, d, &j );
 }
 
+/* create jobs in batches, the parent is counted once with fetch_add( n ),
+ * each batch is queued with multi_push(), running jobs when queue is full */
+void
+JobTaskThread::create_jobs( uint32_t n,  JobFunction f,  void **d,  Job *p ) {
+  Job * jar[ 256 ];
+  if ( p != nullptr && n != 0 )
+    p->unfinished_jobs.fetch_add( n, std::memory_order_relaxed );
+  for ( uint32_t i = 0; i < n; ) {
+    uint16_t m = ( n - i > 256 ? 256 : (uint16_t) ( n - i ) ), k = 0;
+    while ( k < m ) {
+      uint16_t  cnt = m - k;
+      uint8_t * mem = (uint8_t *) this->alloc_jobs( cnt );
+      for ( ; cnt > 0; cnt-- ) {
+        Job * j = new ( mem ) Job( *this, f,
+                                   d != nullptr ? d[ i + k ] : nullptr );
+        j->parent  = p; /* already counted by fetch_add above */
+        jar[ k++ ] = j;
+        mem       += JobAllocBlock::JOB_SIZE;
+      }
+    }
+    this->do_work_and_kick_jobs( jar, m );
+    i += m;
+  }
+}
+
+/* the newest job is usually hot in the cache, but under a steady stream of
+ * jobs the oldest may wait until stolen, the interval bounds this wait */
+Job *
+JobTaskThread::pop_job( void ) {
+  if ( this->fifo_interval == 0 )
+    return this->queue.pop();
+  /* only pops which return a job count, so the idle spins in
+   * get_valid_job() don't move the position within the interval */
+  Job * j;
+  if ( this->pop_count + 1 >= this->fifo_interval ) { /* FIFO turn */
+    if ( (j = this->queue.pop_top()) == nullptr )
+      j = this->queue.pop();
+    if ( j != nullptr )
+      this->pop_count = 0;
+    return j;
+  }
+  if ( (j = this->queue.pop()) != nullptr )
+    this->pop_count += 1;
+  return j;
+}
+
 /* find a job to run, look at task's queue
  * if no jobs there, then try to steal a job randomly from another task */
 Job *
 JobTaskThread::get_valid_job( void ) {
-  Job * j = this->queue.pop();
-  if ( j != nullptr )
+  JOB_PROF_START( t );
+  Job * j = this->pop_job();
+  if ( j != nullptr ) {
+    JOB_PROF_END( *this, PROF_POP, t );
     return j;
+  }
   Job    * jar[ 64 ];
   uint16_t n     = this->queue.multi_push_avail( 63 );
   uint32_t count = this->ctx.task_count.load( std::memory_order_relaxed ),
@@ -410,12 +894,16 @@ JobTaskThread::get_valid_job( void ) {
       if ( n > 0 ) {
         if ( n > 1 )
           this->queue.multi_push( &jar[ 1 ], n - 1 );
+        JOB_PROF_END( *this, PROF_STEAL, t );
         return jar[ 0 ];
       }
     }
     if ( ++next == count )
       next = 0;
   }
+  /* idle, release finished job memory */
+  this->flush_release();
+  JOB_PROF_END( *this, PROF_IDLE, t );
   return nullptr;
 }
 
@@ -437,9 +925,12 @@ JobTaskThread::wait_for_termination( void ) {
         is_waiting = true;
         this->ctx.wait_count.fetch_add( 1, std::memory_order_relaxed );
       }
+      JOB_PROF_START( t );
       pause_thread();
+      JOB_PROF_ADD( *this, PROF_IDLE, t ); /* counted by get_valid_job() */
     }
   }
+  this->flush_release();
 }
 
 /* task runs a job */
@@ -454,8 +945,41 @@ JobTaskThread::execute( Job &j ) {
   }
   else {
     j.execute_worker_id = this->worker_id;
+#if JOB_MONITOR
+    /* a job may execute other jobs while it waits, the innermost job is
+     * published, the enclosing job is restored when it returns */
+    JobFunction prev = this->exec_function.load( std::memory_order_relaxed );
+    uint64_t    cnt  = this->exec_count.load( std::memory_order_relaxed );
+    this->exec_function.store( j.function, std::memory_order_relaxed );
+    this->exec_count.store( cnt + 1, std::memory_order_relaxed );
+#endif
+#if JOB_PROFILE
+    /* a job function may execute() other jobs and use the scheduler, these
+     * cycles are nested and are subtracted, so the job's cycles are its own,
+     * the whole execute() is then nested within the enclosing job, if any */
+    JobFunction f         = j.function; /* j may be released by finish() */
+    bool        is_stolen = ( &j.thr != this );
+    uint64_t    outer     = this->prof.nested_cycles;
+    this->prof.nested_cycles = 0;
+    uint64_t    t0        = get_cycles();
     j.function( *this, j );
-    j.finish();
+    uint64_t    t1        = get_cycles(),
+                inner     = this->prof.nested_cycles;
+    j.finish( *this );
+    uint64_t    t2        = get_cycles();
+    this->prof.add_job( f, t1 - t0 - inner, t1 - t0, is_stolen );
+    this->prof.add_sched( PROF_FINISH, t2 - t1 );
+    this->prof.nested_cycles = outer + ( t2 - t0 );
+#else
+    j.function( *this, j );
+    j.finish( *this );
+#endif
+#if JOB_MONITOR
+    /* the enclosing job resumes, count it so that its stall time restarts */
+    cnt = this->exec_count.load( std::memory_order_relaxed );
+    this->exec_function.store( prev, std::memory_order_relaxed );
+    this->exec_count.store( cnt + 1, std::memory_order_relaxed );
+#endif
   }
 }
 
@@ -464,12 +988,15 @@ void
 JobTaskThread::kick_and_wait_for( Job &j ) {
   j.is_waiting = true;
   j.kick();
-  while ( j.unfinished_jobs.load( std::memory_order_relaxed ) != 0 ) {
+  while ( j.unfinished_jobs.load( std::memory_order_acquire ) != 0 ) {
     Job *k = this->get_valid_job();
     if ( k != nullptr )
       this->execute( *k );
-    else
+    else {
+      JOB_PROF_START( t );
       pause_thread();
+      JOB_PROF_ADD( *this, PROF_IDLE, t ); /* counted by get_valid_job() */
+    }
   }
 }
 
@@ -479,14 +1006,15 @@ void
 JobTaskThread::kick_jobs( Job **jar,  uint16_t n ) {
   uint16_t j;
   for ( uint16_t i = 0; i < n; i += j ) {
+    JOB_PROF_START( t );
     j = this->queue.multi_push_avail( n - i );
-    if ( j == 0 ) {
+    if ( j != 0 )
+      this->queue.multi_push( &jar[ i ], j );
+    JOB_PROF_END( *this, PROF_PUSH, t );
+    if ( j == 0 ) { /* kick() is measured by itself */
       jar[ i ]->kick();
       j = 1;
     }
-    else {
-      this->queue.multi_push( &jar[ i ], j );
-    }
   }
 }
 
@@ -505,14 +1033,21 @@ JobTaskThread::do_work_and_kick_jobs( Job **jar,  uint16_t n ) {
       cnt = n - i;
       if ( cnt > avail )
         cnt = avail;
+      JOB_PROF_START( t );
       this->queue.multi_push( &jar[ i ], cnt );
+      JOB_PROF_END( *this, PROF_PUSH, t );
       i += cnt;
       if ( i == n )
         return;
     }
-    while ( (avail = this->queue.multi_push_avail( n - i )) == 0 ) {
+    for (;;) {
+      JOB_PROF_START( t );
+      avail = this->queue.multi_push_avail( n - i );
+      JOB_PROF_END( *this, PROF_PUSH, t );
+      if ( avail != 0 )
+        break;
       for ( cnt = 0; cnt < n - i; cnt++ ) {
-        Job *j = this->queue.pop();
+        Job *j = this->pop_job();
         if ( j == nullptr )
           break;
         this->execute( *j );
@@ -533,9 +1068,12 @@ Job::Job( JobTaskThread &t,  JobFunction f,  void *d,  Job *p )
 
 void
 Job::kick( void ) { /* queue for execute() */
+  JOB_PROF_START( t );
   for (;;) {
-    if ( this->try_kick() )
+    if ( this->try_kick() ) {
+      JOB_PROF_END( this->thr, PROF_PUSH, t );
       return;
+    }
     /* may want to throw error if deadlock detected by no space available:
      * if all threads are queuing jobs and all entries[] are used */
     pause_thread();
@@ -547,15 +1085,187 @@ Job::try_kick( void ) {
   return this->thr.queue.try_push( *this );
 }
 
+/* when a thread is waiting for the job, it may release the job as soon as
+ * unfinished_jobs is zero, so the job is not touched after that; the
+ * fetch_sub() releases the job's writes and acquires the children's, the
+ * waiter's acquire load then sees everything written before the join */
 void
-Job::finish( void ) {
+Job::finish( JobTaskThread &t ) {
+  Job * p          = this->parent;
+  bool  is_waiting = this->is_waiting;
   uint32_t res = this->unfinished_jobs.
-                     fetch_sub( 1, std::memory_order_relaxed );
-  if ( this->parent != nullptr && res == 1 ) /* last child */
-    this->parent->finish();
-  this->is_done = true;
-  if ( ! this->is_waiting ) /* a thread is waiting for job, it must release */
-    this->alloc_block.deref(); /* no need for job memory any more */;
+                     fetch_sub( 1, std::memory_order_acq_rel );
+  if ( res != 1 ) /* children still running, the last one finishes */
+    return;
+  if ( p != nullptr ) /* last child of parent */
+    p->finish( t );
+  if ( ! is_waiting ) { /* a thread is waiting for job, it must release */
+    this->is_done = true;
+    this->release( t );
+  }
+}
+
+void
+Job::release( JobTaskThread &t ) {
+#if JOB_SLOT_ALLOC
+  t.release_slot( *this );
+#else
+  t.release_job( this->alloc_block ); /* deref() batched by t */
+#endif
+}
+
+#if JOB_MONITOR
+/* the conditions found by the monitor */
+enum JobMonitorEvent {
+  MON_LONG_JOB = 0, /* the same job is executing for over stall_ns, time
+                       restarts when a job it executes while waiting ends */
+  MON_DEEP_QUEUE    /* queue has deep_jobs or more for more than stall_ns,
+                       while other workers are waiting for work */
+};
+struct JobMonitor;
+/* called by the monitor thread, ns is how long the condition has lasted */
+typedef void (*JobMonitorFunction)( JobMonitor &mon,  JobTaskThread &thr,
+                                    JobMonitorEvent ev,  uint64_t ns );
+
+/* the monitor's view of a worker, from the previous samples */
+struct JobMonitorSample {
+  uint64_t exec_count, /* exec_count when first seen */
+           exec_ns,    /* time exec_count was first seen */
+           deep_ns;    /* time queue was first seen deep, 0 if not deep */
+  bool     is_long,    /* reported, don't report again until next job */
+           is_deep;    /* reported, don't report again until not deep */
+};
+
+/* a thread which samples the workers every period_ns, it only loads the
+ * published exec_count, exec_function, queue idx and push_avail, so that
+ * the owners' cache lines are only shared once per period; a condition
+ * is reported once, to the callback if set, otherwise dumped to fp */
+struct JobMonitor {
+  JobSysCtx        & ctx;
+  uint64_t           period_ns,   /* time between samples */
+                     stall_ns;    /* report a condition lasting this long */
+  uint32_t           deep_jobs;   /* a queue is deep with this many jobs */
+  JobMonitorFunction cb;          /* called when condition found, or null */
+  void             * data;        /* closure for cb */
+  FILE             * fp;          /* dump when cb is null */
+  std::atomic<bool>  is_running;  /* thread exits when false */
+  std::thread        thr;         /* the monitor thread */
+  uint64_t           sample_count, /* number of sample periods */
+                     long_count,   /* MON_LONG_JOB reported */
+                     deep_count;   /* MON_DEEP_QUEUE reported */
+  JobMonitorSample   sample[ MAX_TASKS ];
+
+  JobMonitor( JobSysCtx &c,  uint64_t period = 1000 * 1000,
+              uint64_t stall = 10 * 1000 * 1000,  uint32_t deep = 1024 )
+    : ctx( c ), period_ns( period ), stall_ns( stall ), deep_jobs( deep ),
+      cb( 0 ), data( 0 ), fp( stderr ), is_running( false ),
+      sample_count( 0 ), long_count( 0 ), deep_count( 0 ) {
+    ::memset( (void *) this->sample, 0, sizeof( this->sample ) );
+  }
+  ~JobMonitor() { this->stop(); }
+
+  static uint64_t now_ns( void ) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+  /* start the thread */
+  void start( void );
+  /* stop and join the thread */
+  void stop( void );
+  /* thread loop, sample then sleep */
+  void run( void );
+  /* sample each worker at time now */
+  void check( uint64_t now );
+  /* print the state of a worker */
+  void dump( JobTaskThread &t,  JobMonitorEvent ev,  uint64_t ns );
+};
+
+void
+JobMonitor::start( void ) {
+  this->is_running.store( true, std::memory_order_relaxed );
+  this->thr = std::thread( &JobMonitor::run, this );
 }
 
+void
+JobMonitor::stop( void ) {
+  if ( this->is_running.load( std::memory_order_relaxed ) ) {
+    this->is_running.store( false, std::memory_order_relaxed );
+    this->thr.join();
+  }
+}
+
+void
+JobMonitor::run( void ) {
+  while ( this->is_running.load( std::memory_order_relaxed ) ) {
+    std::this_thread::sleep_for( std::chrono::nanoseconds( this->period_ns ) );
+    this->check( now_ns() );
+  }
+}
+
+void
+JobMonitor::check( uint64_t now ) {
+  uint32_t count   = this->ctx.task_count.load( std::memory_order_relaxed ),
+           waiting = this->ctx.wait_count.load( std::memory_order_relaxed );
+  this->sample_count += 1;
+  for ( uint32_t i = 0; i < count; i++ ) {
+    JobTaskThread    & t = *this->ctx.task[ i ];
+    JobMonitorSample & s = this->sample[ i ];
+    uint64_t    cnt = t.exec_count.load( std::memory_order_relaxed );
+    JobFunction f   = t.exec_function.load( std::memory_order_relaxed );
+    /* the same job is running if exec_count did not move */
+    if ( cnt != s.exec_count || f == nullptr ) {
+      s.exec_count = cnt;
+      s.exec_ns    = now;
+      s.is_long    = false;
+    }
+    else if ( ! s.is_long && now - s.exec_ns >= this->stall_ns ) {
+      s.is_long = true;
+      this->long_count += 1;
+      if ( this->cb != nullptr )
+        this->cb( *this, t, MON_LONG_JOB, now - s.exec_ns );
+      else
+        this->dump( t, MON_LONG_JOB, now - s.exec_ns );
+    }
+    /* jobs are waiting in this queue while other workers have nothing */
+    WSQIndex q( t.queue.idx.load( std::memory_order_relaxed ) );
+    if ( q.count >= this->deep_jobs && waiting > 0 ) {
+      if ( s.deep_ns == 0 )
+        s.deep_ns = now;
+      else if ( ! s.is_deep && now - s.deep_ns >= this->stall_ns ) {
+        s.is_deep = true;
+        this->deep_count += 1;
+        if ( this->cb != nullptr )
+          this->cb( *this, t, MON_DEEP_QUEUE, now - s.deep_ns );
+        else
+          this->dump( t, MON_DEEP_QUEUE, now - s.deep_ns );
+      }
+    }
+    else {
+      s.deep_ns = 0;
+      s.is_deep = false;
+    }
+  }
+}
+
+void
+JobMonitor::dump( JobTaskThread &t,  JobMonitorEvent ev,  uint64_t ns ) {
+  char        name[ 256 ];
+  JobFunction f = t.exec_function.load( std::memory_order_relaxed );
+  WSQIndex    q( t.queue.idx.load( std::memory_order_relaxed ) );
+  /* push_avail is owned by the worker, this is only a hint */
+  uint16_t    avail = __atomic_load_n( &t.queue.push_avail, __ATOMIC_RELAXED );
+  if ( f != nullptr )
+    job_symbol( f, name, sizeof( name ) );
+  else
+    ::snprintf( name, sizeof( name ), "(idle)" );
+  ::fprintf( this->fp, "monitor: worker %u %s %.3f ms, job %s, exec %lu, "
+             "queue count %u top %u bottom %u push_avail %u, waiting %u\n",
+             t.worker_id, ev == MON_LONG_JOB ? "long job" : "deep queue",
+             (double) ns / 1000000.0, name,
+             t.exec_count.load( std::memory_order_relaxed ), q.count, q.top,
+             q.bottom, avail,
+             this->ctx.wait_count.load( std::memory_order_relaxed ) );
+}
+#endif
+
 } /* namespace job */
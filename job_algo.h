@@ -0,0 +1,321 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include "job.h"
+
+/* parallel algorithms built on the job system:
+ *
+ *   parallel_sort()           : sort runs with std::sort, then merge pairs of
+ *                               runs, each merge split into output pieces
+ *   parallel_inclusive_scan() : two pass blocked scan, sum each block, scan
+ *   parallel_exclusive_scan()   the block sums, then scan each block again
+ *
+ * each pass creates the jobs as children of a waiting job, the calling
+ * thread runs jobs until all of the children have finished */
+
+namespace job {
+                    /* arrays smaller than this are processed serially, it is
+                     * also the size of a sorted run and of a scan block, so
+                     * that a job works within the L2 cache */
+static const size_t PARALLEL_CUTOFF_BYTES = 256 * 1024;
+
+static void
+nop_job( JobTaskThread &,  Job & ) {}
+
+/* run n jobs with closures d[], return when all have finished */
+static inline void
+run_jobs_and_wait( JobTaskThread &thr,  JobFunction f,  void **d,
+                   uint32_t n ) {
+  Job * root = thr.create_job( nop_job );
+  thr.create_jobs( n, f, d, root );
+  thr.kick_and_wait_for( *root );
+  root->release( thr ); /* waiting job must be released by waiter */
+}
+
+/* number of elements processed by one job */
+template <class T>
+static inline size_t
+parallel_cutoff( void ) {
+  size_t n = PARALLEL_CUTOFF_BYTES / sizeof( T );
+  return n > 1 ? n : 1;
+}
+
+/* sort one run of the array, in place or into the uninitialized out[] */
+template <class T, class Cmp>
+struct SortRun {
+  T   * data,
+      * out;  /* null if sorted in place */
+  size_t n;
+  Cmp * cmp;
+
+  static void run( JobTaskThread &,  Job &j ) {
+    SortRun & r = *(SortRun *) j.data;
+    T * p = r.data;
+    if ( r.out != nullptr ) {
+      std::uninitialized_copy( r.data, &r.data[ r.n ], r.out );
+      p = r.out;
+    }
+    std::sort( p, &p[ r.n ], *r.cmp );
+  }
+};
+
+/* merge output elements [ off, end ) of the sorted runs a[] and b[] */
+template <class T, class Cmp>
+struct MergePiece {
+  const T * a,
+          * b;
+  T       * out;
+  size_t    na, nb,
+            off, end;
+  Cmp     * cmp;
+  bool      is_raw; /* out[] is uninitialized, construct the elements */
+
+  /* the number of elements of a[] which are in the first k output
+   * elements, ties are taken from a[] first, like std::merge() */
+  size_t co_rank( size_t k ) const {
+    size_t lo = ( k > this->nb ? k - this->nb : 0 ),
+           hi = ( k < this->na ? k : this->na );
+    while ( lo < hi ) {
+      size_t i = ( lo + hi ) / 2;
+      if ( (*this->cmp)( this->b[ k - i - 1 ], this->a[ i ] ) )
+        hi = i;
+      else
+        lo = i + 1;
+    }
+    return lo;
+  }
+  static void run( JobTaskThread &,  Job &j ) {
+    MergePiece & p = *(MergePiece *) j.data;
+    size_t i0 = p.co_rank( p.off ),
+           i1 = p.co_rank( p.end ),
+           j0 = p.off - i0,
+           j1 = p.end - i1;
+    if ( ! p.is_raw ) {
+      std::merge( &p.a[ i0 ], &p.a[ i1 ], &p.b[ j0 ], &p.b[ j1 ],
+                  &p.out[ p.off ], *p.cmp );
+      return;
+    }
+    T * o = &p.out[ p.off ];
+    for ( ; i0 < i1 && j0 < j1; o++ ) {
+      if ( (*p.cmp)( p.b[ j0 ], p.a[ i0 ] ) )
+        new ( o ) T( p.b[ j0++ ] );
+      else
+        new ( o ) T( p.a[ i0++ ] );
+    }
+    o = std::uninitialized_copy( &p.a[ i0 ], &p.a[ i1 ], o );
+    std::uninitialized_copy( &p.b[ j0 ], &p.b[ j1 ], o );
+  }
+};
+
+/* sort data[ 0 .. n ) using cmp, the runs are sorted by std::sort and
+ * merged between data[] and a temporary array of n elements, which is not
+ * initialized, the first pass to write it constructs the elements */
+template <class T, class Cmp>
+void
+parallel_sort( JobTaskThread &thr,  T *data,  size_t n,  Cmp cmp ) {
+  const size_t cutoff = parallel_cutoff<T>();
+  if ( n <= cutoff ||
+       thr.ctx.task_count.load( std::memory_order_relaxed ) <= 1 ) {
+    std::sort( data, &data[ n ], cmp );
+    return;
+  }
+  const size_t nruns = ( n + cutoff - 1 ) / cutoff;
+  std::vector<SortRun<T, Cmp> >   runs( nruns );
+  std::vector<MergePiece<T, Cmp> > pieces;
+  std::vector<void *>             d( nruns );
+  T * tmp = (T *) ::malloc( n * sizeof( T ) );
+  size_t passes = 0;
+
+  for ( size_t width = cutoff; width < n; width *= 2 )
+    passes++;
+  /* each pass swaps the buffers, when the count is odd the runs are sorted
+   * into tmp[], so that the last pass merges into data[] */
+  T * src = ( passes % 2 == 0 ? data : tmp ),
+    * dst = ( passes % 2 == 0 ? tmp : data );
+  for ( size_t k = 0; k < nruns; k++ ) {
+    size_t off = k * cutoff;
+    runs[ k ].data = &data[ off ];
+    runs[ k ].out  = ( src == tmp ? &tmp[ off ] : nullptr );
+    runs[ k ].n    = ( n - off < cutoff ? n - off : cutoff );
+    runs[ k ].cmp  = &cmp;
+    d[ k ] = &runs[ k ];
+  }
+  run_jobs_and_wait( thr, SortRun<T, Cmp>::run, d.data(), (uint32_t) nruns );
+
+  bool is_raw = ( dst == tmp ); /* tmp[] is constructed by the first pass */
+  for ( size_t width = cutoff; width < n; width *= 2 ) {
+    pieces.clear();
+    for ( size_t lo = 0; lo < n; lo += 2 * width ) {
+      MergePiece<T, Cmp> p;
+      p.a      = &src[ lo ];
+      p.na     = ( n - lo < width ? n - lo : width );
+      p.b      = &src[ lo + p.na ];
+      p.nb     = ( n - lo - p.na < width ? n - lo - p.na : width );
+      p.out    = &dst[ lo ];
+      p.cmp    = &cmp;
+      p.is_raw = is_raw;
+      for ( p.off = 0; p.off < p.na + p.nb; p.off += cutoff ) {
+        p.end = p.off + cutoff;
+        if ( p.end > p.na + p.nb )
+          p.end = p.na + p.nb;
+        pieces.push_back( p );
+      }
+    }
+    d.resize( pieces.size() );
+    for ( size_t k = 0; k < pieces.size(); k++ )
+      d[ k ] = &pieces[ k ];
+    run_jobs_and_wait( thr, MergePiece<T, Cmp>::run, d.data(),
+                       (uint32_t) pieces.size() );
+    std::swap( src, dst );
+    is_raw = false;
+  }
+  for ( size_t i = 0; i < n; i++ )
+    tmp[ i ].~T();
+  ::free( tmp );
+}
+
+template <class T>
+void
+parallel_sort( JobTaskThread &thr,  T *data,  size_t n ) {
+  parallel_sort( thr, data, n, std::less<T>() );
+}
+
+/* one block of a scan, fold() is the first pass, scan() is the second */
+template <class T, class Op>
+struct ScanBlock {
+  const T * in;
+  T       * out;
+  size_t    n;
+  T         sum;      /* result of pass one, the fold of in[] */
+  const T * carry;    /* fold of the previous blocks, null if first block */
+  Op      * op;
+  bool      is_inclusive;
+
+  void fold( void ) {
+    T acc = this->in[ 0 ];
+    for ( size_t i = 1; i < this->n; i++ )
+      acc = (*this->op)( acc, this->in[ i ] );
+    this->sum = acc;
+  }
+  void scan( void ) {
+    size_t i = 0;
+    T acc;
+    if ( this->carry == nullptr ) { /* inclusive first block */
+      acc = this->in[ 0 ];
+      this->out[ 0 ] = acc;
+      i = 1;
+    }
+    else {
+      acc = *this->carry;
+    }
+    if ( this->is_inclusive ) {
+      for ( ; i < this->n; i++ ) {
+        acc = (*this->op)( acc, this->in[ i ] );
+        this->out[ i ] = acc;
+      }
+    }
+    else { /* read in[] before writing, in[] may be the same as out[] */
+      for ( ; i < this->n; i++ ) {
+        T x = this->in[ i ];
+        this->out[ i ] = acc;
+        acc = (*this->op)( acc, x );
+      }
+    }
+  }
+  static void fold_run( JobTaskThread &,  Job &j ) {
+    ((ScanBlock *) j.data)->fold();
+  }
+  static void scan_run( JobTaskThread &,  Job &j ) {
+    ((ScanBlock *) j.data)->scan();
+  }
+};
+
+/* the exclusive scan passes init, the inclusive passes null */
+template <class T, class Op>
+void
+parallel_scan( JobTaskThread &thr,  const T *in,  T *out,  size_t n,
+               const T *init,  Op op ) {
+  if ( n == 0 )
+    return;
+  const size_t cutoff = parallel_cutoff<T>();
+  const size_t nblks  = ( n + cutoff - 1 ) / cutoff;
+  std::vector<ScanBlock<T, Op> > blk( nblks );
+  std::vector<T>                 carry( nblks );
+  std::vector<void *>            d( nblks );
+
+  for ( size_t k = 0; k < nblks; k++ ) {
+    size_t off = k * cutoff;
+    blk[ k ].in           = &in[ off ];
+    blk[ k ].out          = &out[ off ];
+    blk[ k ].n            = ( n - off < cutoff ? n - off : cutoff );
+    blk[ k ].carry        = nullptr;
+    blk[ k ].op           = &op;
+    blk[ k ].is_inclusive = ( init == nullptr );
+    d[ k ] = &blk[ k ];
+  }
+  if ( nblks > 1 &&
+       thr.ctx.task_count.load( std::memory_order_relaxed ) > 1 ) {
+    /* pass one: fold each block, except the last */
+    run_jobs_and_wait( thr, ScanBlock<T, Op>::fold_run, d.data(),
+                       (uint32_t) ( nblks - 1 ) );
+    /* scan the block sums serially, these are the carry for each block */
+    for ( size_t k = 0; k < nblks; k++ ) {
+      if ( k == 0 ) {
+        if ( init == nullptr )
+          continue;
+        carry[ k ] = *init;
+      }
+      else if ( k == 1 && init == nullptr )
+        carry[ k ] = blk[ 0 ].sum;
+      else
+        carry[ k ] = op( carry[ k - 1 ], blk[ k - 1 ].sum );
+      blk[ k ].carry = &carry[ k ];
+    }
+    /* pass two: scan each block starting with its carry */
+    run_jobs_and_wait( thr, ScanBlock<T, Op>::scan_run, d.data(),
+                       (uint32_t) nblks );
+  }
+  else { /* serial, one block covers everything */
+    ScanBlock<T, Op> & b = blk[ 0 ];
+    b.n = n;
+    if ( init != nullptr ) {
+      carry[ 0 ] = *init;
+      b.carry = &carry[ 0 ];
+    }
+    b.scan();
+  }
+}
+
+/* out[ i ] = in[ 0 ] op ... op in[ i ], in may be the same as out */
+template <class T, class Op>
+void
+parallel_inclusive_scan( JobTaskThread &thr,  const T *in,  T *out,
+                         size_t n,  Op op ) {
+  parallel_scan( thr, in, out, n, (const T *) nullptr, op );
+}
+
+template <class T>
+void
+parallel_inclusive_scan( JobTaskThread &thr,  const T *in,  T *out,
+                         size_t n ) {
+  parallel_scan( thr, in, out, n, (const T *) nullptr, std::plus<T>() );
+}
+
+/* out[ i ] = init op in[ 0 ] op ... op in[ i - 1 ], out[ 0 ] = init */
+template <class T, class Op>
+void
+parallel_exclusive_scan( JobTaskThread &thr,  const T *in,  T *out,
+                         size_t n,  T init,  Op op ) {
+  parallel_scan( thr, in, out, n, &init, op );
+}
+
+template <class T>
+void
+parallel_exclusive_scan( JobTaskThread &thr,  const T *in,  T *out,
+                         size_t n,  T init ) {
+  parallel_scan( thr, in, out, n, &init, std::plus<T>() );
+}
+
+} /* namespace job */
@@ -0,0 +1,149 @@
+#include <iostream>
+#include "job_algo.h"
+#include <thread>
+#include <chrono>
+#include <numeric>
+
+using namespace job;
+
+static void
+worker_thread_function( JobTaskThread *w ) {
+  w->wait_for_termination(); /* run jobs until done */
+}
+
+/* cpus used and array sizes */
+static uint64_t min_elems = 1000000,    /* start with this many elements */
+                max_elems = 100000000;  /* multiply by 10 until this size */
+static uint32_t num_cores = 8;          /* can't be more than MAX_TASKS */
+
+static const char *
+get_arg( int argc, char *argv[], int b, const char *f )
+{
+  for ( int i = 1; i < argc - b; i++ )
+    if ( ::strcmp( f, argv[ i ] ) == 0 ) /* -c cores */
+      return argv[ i + b ];
+  return nullptr;
+}
+
+static uint64_t
+elapsed_nanos( std::chrono::high_resolution_clock::time_point start_time ) {
+  std::chrono::high_resolution_clock::time_point end_time =
+    std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    end_time - start_time ).count();
+}
+
+int
+main( int argc,  char *argv[] ) {
+  const char * graph = get_arg( argc, argv, 0, "-g" ),
+             * cores = get_arg( argc, argv, 1, "-c" ),
+             * elems = get_arg( argc, argv, 1, "-n" ),
+             * first = get_arg( argc, argv, 1, "-m" ),
+             * help  = get_arg( argc, argv, 0, "-h" );
+
+  if ( cores != nullptr )
+    num_cores = atoi( cores );
+  if ( elems != nullptr )
+    max_elems = strtoull( elems, nullptr, 0 );
+  if ( first != nullptr )
+    min_elems = strtoull( first, nullptr, 0 );
+  if ( help != nullptr || num_cores == 0 || num_cores >= MAX_TASKS ||
+       min_elems == 0 || min_elems > max_elems ) {
+    printf( "%s [-g] [-c cores] [-m elems] [-n elems] [-h]\n"
+            "   -g       : produce format for graph plotting\n"
+            "   -c cores : number of threads to test\n"
+            "   -m elems : smallest array size (default 1000000)\n"
+            "   -n elems : largest array size, 10x steps (default 100000000)\n",
+            argv[ 0 ] );
+    printf( "maximum core count is %u\n", MAX_TASKS );
+    return 1;
+  }
+
+  std::chrono::high_resolution_clock::time_point start_time;
+  JobSysCtx job_context;
+  job_context.activate();
+
+  JobTaskThread * m, /* main thread */
+                * w; /* a worker thread */
+  start_time = std::chrono::high_resolution_clock::now();
+  m = job_context.initialize_worker( start_time.time_since_epoch().count(),
+                                     nullptr );
+  /* start num_cores - 1 threads */
+  std::thread worker_threads[ num_cores - 1 ];
+  for ( uint32_t i = 1; i < num_cores; i++ ) {
+    w = job_context.initialize_worker( m->rand.next(), nullptr );
+    worker_threads[ i - 1 ] = std::thread( worker_thread_function, w );
+  }
+  while ( job_context.wait_count
+                     .load( std::memory_order_relaxed ) != num_cores - 1 )
+    pause_thread();
+
+  if ( ! graph ) {
+    printf( "Number of threads:  %u\n", num_cores );
+    printf( "Elements    std::sort  parallel_sort  Speedup  "
+            "partial_sum  inclusive_scan  Speedup\n"
+            "----------  ---------  -------------  -------  "
+            "-----------  --------------  -------\n" );
+  }
+  for ( uint64_t n = min_elems; n <= max_elems; n *= 10 ) {
+    std::vector<uint64_t> src( n ), ser( n ), par( n );
+    uint64_t ser_sort, par_sort, ser_scan, par_scan;
+    for ( uint64_t i = 0; i < n; i++ )
+      src[ i ] = m->rand.next();
+
+    ser = src;
+    start_time = std::chrono::high_resolution_clock::now();
+    std::sort( ser.begin(), ser.end() );
+    ser_sort = elapsed_nanos( start_time );
+
+    par = src;
+    start_time = std::chrono::high_resolution_clock::now();
+    parallel_sort( *m, par.data(), n );
+    par_sort = elapsed_nanos( start_time );
+    if ( ser != par ) {
+      fprintf( stderr, "parallel_sort differs from std::sort, n=%lu\n", n );
+      return 1;
+    }
+
+    start_time = std::chrono::high_resolution_clock::now();
+    std::partial_sum( src.begin(), src.end(), ser.begin() );
+    ser_scan = elapsed_nanos( start_time );
+
+    start_time = std::chrono::high_resolution_clock::now();
+    parallel_inclusive_scan( *m, src.data(), par.data(), n );
+    par_scan = elapsed_nanos( start_time );
+    if ( ser != par ) {
+      fprintf( stderr, "parallel_inclusive_scan differs from partial_sum, "
+                       "n=%lu\n", n );
+      return 1;
+    }
+    /* exclusive is inclusive shifted by one */
+    parallel_exclusive_scan( *m, src.data(), par.data(), n, (uint64_t) 0 );
+    if ( par[ 0 ] != 0 ||
+         ! std::equal( par.begin() + 1, par.end(), ser.begin() ) ) {
+      fprintf( stderr, "parallel_exclusive_scan differs from partial_sum, "
+                       "n=%lu\n", n );
+      return 1;
+    }
+
+    if ( ! graph ) {
+      printf( "%10lu  %6lu ms  %10lu ms  %7.2f  %8lu ms  %11lu ms  %7.2f\n",
+              n, ser_sort / 1000000, par_sort / 1000000,
+              (double) ser_sort / (double) par_sort,
+              ser_scan / 1000000, par_scan / 1000000,
+              (double) ser_scan / (double) par_scan );
+    }
+    else {
+      printf( "%lu %lu %lu %.2f %lu %lu %.2f\n", n, ser_sort, par_sort,
+              (double) ser_sort / (double) par_sort, ser_scan, par_scan,
+              (double) ser_scan / (double) par_scan );
+    }
+  }
+  job_context.deactivate();   /* tell threads to exit */
+
+  /* reap the threads created */
+  for ( uint32_t i = 1; i < num_cores; i++ )
+    worker_threads[ i - 1 ].join();
+
+  return 0;
+}
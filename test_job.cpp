@@ -2,6 +2,9 @@
 #include "job.h"
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <vector>
+#include <sys/resource.h>
 
 using namespace job;
 
@@ -35,19 +38,95 @@ work_task_job( JobTaskThread &w,  Job &/*j*/ ) {
   *(int *) w.data += result;
 }
 
+/* when -l is used, the kick time of each job, replaced by its latency */
+static uint64_t * kick_ns;
+
+static inline uint64_t
+now_ns( void ) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* the time from kick until execute, then the work */
+static void
+latency_task_job( JobTaskThread &w,  Job &j ) {
+  uint64_t * t = (uint64_t *) j.data;
+  *t = now_ns() - *t;
+  work_task_job( w, j );
+}
+
+/* stamp job k with kick time t, if measuring latency */
+static void *
+kick_stamp( uint64_t k,  uint64_t t ) {
+  if ( kick_ns == nullptr )
+    return nullptr;
+  kick_ns[ k ] = t;
+  return &kick_ns[ k ];
+}
+
+/* when -k is used, one of every keep_every jobs is allocated and kept until
+ * exit, like a long running job, which pins the memory around it */
+static uint32_t keep_every, keep_count;
+static std::vector<Job *> kept_jobs;
+
+static void
+keep_jobs( JobTaskThread &w,  uint64_t m ) {
+  if ( keep_every == 0 )
+    return;
+  for ( keep_count += m; keep_count >= keep_every; keep_count -= keep_every ) {
+    Job * j = w.create_job( work_task_job );
+    j->is_waiting = true; /* not run, released at exit */
+    kept_jobs.push_back( j );
+  }
+}
+
+#if ! SINGLE_CREATE_JOBS
+/* allocates slots and notifies parent once per batch */
+static void
+create_work_jobs( JobTaskThread &w,  Job *p,  uint64_t njobs ) {
+  if ( kick_ns == nullptr && keep_every == 0 ) {
+    w.create_jobs( njobs, work_task_job, nullptr, p );
+    return;
+  }
+  void   * d[ 256 ];
+  uint64_t m = 256;
+  for ( uint64_t k = 0; k < njobs; k += m ) {
+    if ( k + 256 > njobs )
+      m = njobs - k;
+    if ( kick_ns != nullptr ) {
+      uint64_t t = now_ns();
+      for ( uint64_t i = 0; i < m; i++ )
+        d[ i ] = kick_stamp( k + i, t );
+      w.create_jobs( m, latency_task_job, d, p );
+    }
+    else {
+      w.create_jobs( m, work_task_job, nullptr, p );
+    }
+    keep_jobs( w, m );
+  }
+}
+#endif
+
 /* this version has a parent child relationship, with lock: xadd notify */
 #if SLOWER_START_JOBS
 static void
 slower_start_jobs( JobTaskThread &w,  Job &j,  uint64_t njobs ) {
+#if ! SINGLE_CREATE_JOBS
+  create_work_jobs( w, &j, njobs );
+#else
+  JobFunction f = ( kick_ns != nullptr ? latency_task_job : work_task_job );
   Job *jar[ 256 ];
   uint64_t m = 256;
   for ( uint64_t k = 0; k < njobs; k += m ) {
     if ( k + 256 > njobs )
       m = njobs - k;
+    uint64_t t = ( kick_ns != nullptr ? now_ns() : 0 );
     for ( uint64_t i = 0; i < m; i++ )
-      jar[ i ] = w.create_job_as_child( j, work_task_job );
+      jar[ i ] = w.create_job_as_child( j, f, kick_stamp( k + i, t ) );
     w.do_work_and_kick_jobs( jar, m );
+    keep_jobs( w, m );
   }
+#endif
 }
 
 static void
@@ -58,15 +137,22 @@ root_job_function( JobTaskThread &w,  Job &j ) {
 
 static void
 faster_start_jobs( JobTaskThread &w,  uint64_t njobs ) {
+#if ! SINGLE_CREATE_JOBS
+  create_work_jobs( w, nullptr, njobs );
+#else
+  JobFunction f = ( kick_ns != nullptr ? latency_task_job : work_task_job );
   Job *jar[ 256 ];
   uint64_t m = 256;
   for ( uint64_t k = 0; k < njobs; k += m ) {
     if ( k + 256 > njobs )
       m = njobs - k;
+    uint64_t t = ( kick_ns != nullptr ? now_ns() : 0 );
     for ( uint64_t i = 0; i < m; i++ )
-      jar[ i ] = w.create_job( work_task_job );
+      jar[ i ] = w.create_job( f, kick_stamp( k + i, t ) );
     w.do_work_and_kick_jobs( jar, m );
+    keep_jobs( w, m );
   }
+#endif
 }
 #endif
 
@@ -91,7 +177,12 @@ main( int argc,  char *argv[] ) {
              * cores = get_arg( argc, argv, 1, "-c" ),
              * jobs  = get_arg( argc, argv, 1, "-j" ),
              * iters = get_arg( argc, argv, 1, "-i" ),
+             * fifo  = get_arg( argc, argv, 1, "-f" ),
+             * lat   = get_arg( argc, argv, 0, "-l" ),
+             * keep  = get_arg( argc, argv, 1, "-k" ),
+             * mon   = get_arg( argc, argv, 1, "-m" ),
              * help  = get_arg( argc, argv, 0, "-h" );
+  uint32_t fifo_interval = 0;
 
   if ( cores != nullptr )
     num_cores = atoi( cores );
@@ -99,14 +190,24 @@ main( int argc,  char *argv[] ) {
     parallel_jobs = atoi( jobs );
   if ( iters != nullptr )
     serial_iterations = atoi( iters );
+  if ( fifo != nullptr )
+    fifo_interval = atoi( fifo );
+  if ( keep != nullptr )
+    keep_every = atoi( keep );
   if ( help != nullptr ||
        num_cores == 0 || parallel_jobs == 0 || serial_iterations == 0 ||
-       num_cores >= MAX_TASKS ) {
-    printf( "%s [-g] [-c cores] [-j jobs] [-i iters] [-h]\n"
+       num_cores >= MAX_TASKS || fifo_interval > 0xffff ) {
+    printf( "%s [-g] [-c cores] [-j jobs] [-i iters] [-f intv] [-l] [-k n] "
+            "[-m us] [-h]\n"
             "   -g       : produce format for graph plotting\n"
             "   -c cores : number of threads to test\n"
             "   -j jobs  : number of jobs t0 run for parallel portion\n"
-            "   -i iters : number of iterations to run for serial portion\n",
+            "   -i iters : number of iterations to run for serial portion\n"
+            "   -f intv  : owner pops oldest job every intv pops (1 = FIFO)\n"
+            "   -l       : measure kick to execute latency (p50, p99)\n"
+            "   -k n     : keep one of every n jobs allocated until exit\n"
+            "   -m us    : sample workers every us microseconds, when built\n"
+            "              with JOB_MONITOR\n",
             argv[ 0 ] );
     printf( "maximum core count is %u\n", MAX_TASKS );
     return 1;
@@ -124,8 +225,12 @@ main( int argc,  char *argv[] ) {
     printf( "Number of threads:  %u\n", num_cores );
     printf( "Serial workload:    %u iterations\n", serial_iterations );
     printf( "Parallel workload:  %u jobs\n", parallel_jobs );
+    printf( "FIFO interval:      %u\n", fifo_interval );
   }
+  if ( lat != nullptr )
+    kick_ns = new uint64_t[ parallel_jobs ];
   JobSysCtx job_context;
+  job_context.set_fifo_interval( fifo_interval );
   job_context.activate();
 
   JobTaskThread * m, /* main thread */
@@ -156,8 +261,10 @@ main( int argc,  char *argv[] ) {
 
   if ( ! graph ) {
     printf( "\n" );
-    printf( "Workload  Serial Elapsed  Parallel Elapsed  Speedup\n"
-            "--------  --------------  ----------------  -------\n" );
+    printf( "Workload  Serial Elapsed  Parallel Elapsed  Speedup%s\n"
+            "--------  --------------  ----------------  -------%s\n",
+            kick_ns ? "  Latency p50  Latency p99" : "",
+            kick_ns ? "  -----------  -----------" : "" );
   }
   /* start num_cores - 1 threads */
   std::thread worker_threads[ num_cores - 1 ];
@@ -172,6 +279,16 @@ main( int argc,  char *argv[] ) {
                      .load( std::memory_order_relaxed ) != num_cores - 1 )
     pause_thread();
 
+#if JOB_MONITOR
+  /* sample the workers while the parallel part runs */
+  JobMonitor monitor( job_context );
+  if ( mon != nullptr ) {
+    monitor.period_ns = (uint64_t) atoi( mon ) * 1000;
+    monitor.start();
+  }
+#else
+  (void) mon;
+#endif
   /* calculate the parallel times by starting jobs */
   for ( task_workload = 100; task_workload <= 7000; task_workload += 100 ) {
     /* create the root job, which creates work_tasks */
@@ -181,7 +298,7 @@ main( int argc,  char *argv[] ) {
      * when all children of a parent job are completed */
     Job *j = m->create_job( root_job_function );
     m->kick_and_wait_for( *j ); /* wait until all children of job are done */
-    j->alloc_block.deref(); /* dereference, not needed anymore */
+    j->release( *m ); /* release, not needed anymore */
 #else
     /* faster version just tracks until threads are idle */
     faster_start_jobs( *m, parallel_jobs );
@@ -202,12 +319,23 @@ main( int argc,  char *argv[] ) {
         .count();
     par_per_job = par_elapsed_nanos / parallel_jobs;
 
+    uint64_t p50 = 0, p99 = 0;
+    if ( kick_ns != nullptr ) {
+      std::nth_element( kick_ns, &kick_ns[ parallel_jobs / 2 ],
+                        &kick_ns[ parallel_jobs ] );
+      p50 = kick_ns[ parallel_jobs / 2 ];
+      std::nth_element( kick_ns, &kick_ns[ parallel_jobs * 99 / 100 ],
+                        &kick_ns[ parallel_jobs ] );
+      p99 = kick_ns[ parallel_jobs * 99 / 100 ];
+    }
     size_t x = ( task_workload - 100 ) / 100;
     if ( ! graph ) {
       printf( "%8u  ", task_workload );
       printf( "%11lu ns  ", serial_per_job[ x ] );
       printf( "%13lu ns  ", par_per_job );
       printf( "%7.2f", (double) serial_per_job[ x ] / (double) par_per_job );
+      if ( kick_ns != nullptr )
+        printf( "  %8lu ns  %8lu ns", p50, p99 );
       if ( serial_per_job[ x ] < par_per_job )
         printf( "  (- %lu / thr: %lu)",
                 par_per_job - serial_per_job[ x ],
@@ -215,15 +343,38 @@ main( int argc,  char *argv[] ) {
       printf( "\n" );
     }
     else {
-      printf( "%u %lu %lu %.2f\n", task_workload, serial_per_job[ x ],
+      printf( "%u %lu %lu %.2f", task_workload, serial_per_job[ x ],
              par_per_job, (double) serial_per_job[ x ] / (double) par_per_job );
+      if ( kick_ns != nullptr )
+        printf( " %lu %lu", p50, p99 );
+      printf( "\n" );
     }
   }
+#if JOB_MONITOR
+  monitor.stop();
+  if ( ! graph && mon != nullptr )
+    printf( "Monitor samples:    %lu (long jobs %lu, deep queues %lu)\n",
+            monitor.sample_count, monitor.long_count, monitor.deep_count );
+#endif
   job_context.deactivate();   /* tell threads to exit */
 
   /* reap the threads created */
   for ( uint32_t i = 1; i < num_cores; i++ )
     worker_threads[ i - 1 ].join();
+  /* release the kept jobs, the memory high water mark includes them */
+  for ( size_t i = 0; i < kept_jobs.size(); i++ )
+    kept_jobs[ i ]->release( *m );
+  m->flush_release();
+  if ( ! graph ) {
+    struct rusage usage;
+    ::getrusage( RUSAGE_SELF, &usage );
+    printf( "Kept jobs:          %lu\n", kept_jobs.size() );
+    printf( "Max RSS:            %ld KB\n", usage.ru_maxrss );
+  }
+#if JOB_PROFILE
+  /* graph output is plotted, put the profile on stderr */
+  job_context.profile_report( graph ? stderr : stdout );
+#endif
 
   return 0;
 }